@@ -93,8 +93,21 @@ compile_arm() {
         print_warning "未检测到 libmicrohttpd 环境，将编译不包含 Web 服务器功能的版本"
     fi
     
+    if [ -n "$ZLIB_ROOT" ] && [ -d "$ZLIB_ROOT" ]; then
+        if [ -f "$ZLIB_ROOT/include/zlib.h" ] && [ -f "$ZLIB_ROOT/lib/libz.a" ]; then
+            zlib_include="-I$ZLIB_ROOT/include"
+            zlib_lib="-L$ZLIB_ROOT/lib -lz"
+            cflags="$cflags -DZLIB_AVAILABLE"
+            print_info "检测到 zlib: $ZLIB_ROOT/include/zlib.h, $ZLIB_ROOT/lib/libz.a"
+        else
+            print_warning "zlib 头文件或库文件不存在"
+        fi
+    else
+        print_warning "未检测到 zlib 环境，将编译不包含响应压缩功能的版本"
+    fi
+    
     mkdir -p build
-    if $cc -static $cflags $quickjs_include $microhttpd_include -o $output src/main.c "$PROJECT_ROOT/src/resources"/*.c $quickjs_lib $microhttpd_lib -lm -lpthread; then
+    if $cc -static $cflags $quickjs_include $microhttpd_include $zlib_include -o $output src/main.c "$PROJECT_ROOT/src/resources"/*.c $quickjs_lib $microhttpd_lib $zlib_lib -lm -lpthread; then
         print_success "编译完成: $output"
         echo "$output"
     else
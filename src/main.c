@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,7 +17,9 @@
 #include <sys/types.h>
 #include <execinfo.h>
 #include <fcntl.h>
-#define _GNU_SOURCE
+#include <pthread.h>
+#include <ctype.h>
+#include <time.h>
 
 // 添加必要的函数声明
 char* strdup(const char* str);
@@ -31,8 +34,10 @@ char* strdup(const char* str);
 #include "quickjs.h"
 #endif
 
-// 自动包含资源头文件
-#include "resources/resource_list.h"
+// zlib 头文件（条件编译，用于响应压缩）
+#ifdef ZLIB_AVAILABLE
+#include <zlib.h>
+#endif
 
 // 自动包含资源头文件
 #include "resources/resource_list.h"
@@ -43,9 +48,48 @@ char* strdup(const char* str);
 // 全局变量
 // static char* js_result = NULL;  // 未使用的变量，注释掉
 static struct MHD_Daemon *g_daemon = NULL;
-static char console_output[8192] = ""; // 存储console.log输出
+static volatile sig_atomic_t g_stop = 0; // 收到停止信号后由主循环负责关闭服务器
 static char worker_dir[256] = WORKER_DIR; // 新增全局 worker_dir
 
+#define DEFAULT_CONNECTION_TIMEOUT 30 // keep-alive 空闲连接超时（秒）
+#define COMPRESS_MIN_SIZE 1024        // 小于该大小的响应不压缩
+#define MAX_SCRIPT_HEADERS 16
+#define STATIC_URL_PREFIX "/static/"  // 静态文件挂载点，对应 worker_dir/public
+#define STATIC_DIR_NAME "public"
+#define FD_CACHE_SIZE 32              // 已打开静态文件的缓存数量
+#define DEFAULT_IO_THREADS 2          // 事件循环线程数，负责所有连接的网络收发
+#define DEFAULT_SCRIPT_WORKERS 4      // 常驻脚本执行线程数，全部忙碌时按需增加
+#define WORKER_IDLE_TIMEOUT 60        // 额外增加的脚本执行线程空闲多久后退出（秒）
+// 推送通道只实现 SSE，不支持 WebSocket 升级：SSE 已覆盖服务端到客户端的推送，
+// WebSocket 需要额外的握手、帧编解码和升级后套接字的读写循环
+#define SSE_URL_PATH "/events"        // SSE 订阅地址，/events?topic=a,b
+#define SSE_QUEUE_LIMIT (64 * 1024)   // 单个订阅者积压数据上限，超出后断开慢速客户端
+#define SSE_HEARTBEAT_INTERVAL 15     // SSE 心跳间隔（秒），用于发现已断开的客户端
+#define SCHEDULE_CONFIG_NAME "schedule.conf" // 定时任务配置，位于 worker_dir 下
+#define MAX_SCHEDULED_JOBS 32
+#define MAX_INVOKE_DEPTH 8            // invoke() 最大嵌套层数
+#define SHUTDOWN_DRAIN_TIMEOUT 10     // 停止时等待脚本执行完成的最长时间（秒）
+
+#define CONTENT_TYPE_HTML "text/html; charset=utf-8"
+#define CONTENT_TYPE_JSON "application/json; charset=utf-8"
+
+// 脚本通过 set_status/set_header/set_content_type 设置的响应信息
+struct script_response {
+    int status_code;        // 0 表示未设置
+    char content_type[128]; // 空字符串表示未设置
+    int header_count;
+    char header_names[MAX_SCRIPT_HEADERS][64];
+    char header_values[MAX_SCRIPT_HEADERS][256];
+};
+
+// 单次脚本执行的状态，通过 JS_SetContextOpaque 关联到 JSContext，
+// 每次执行各自持有，并发执行的脚本互不干扰
+struct js_exec_state {
+    char console_output[8192]; // 存储console.log输出
+    struct script_response* response;
+    int invoke_depth;          // 通过 invoke() 嵌套调用的层数，顶层脚本为 0
+};
+
 // 新增端口检测和放行函数
 int is_iptables_available() {
     return system("which iptables > /dev/null 2>&1") == 0;
@@ -72,51 +116,278 @@ void allow_port(int port) {
     }
 }
 
+// 向订阅了 topic 的 SSE 客户端推送消息，返回送达的客户端数量
+int sse_publish(const char* topic, const char* data);
+
+// 添加定时执行的 worker 脚本，返回任务 id，失败返回 -1
+int schedule_script(const char* script, int interval, const char* params);
+// 取消定时任务，成功返回 1
+int unschedule_script(int id);
+
+char* read_file_content(const char* filename);
+
 // 信号处理函数
 static void signal_handler(int sig) {
-#ifdef MICROHTTPD_AVAILABLE
-    if (g_daemon != NULL) {
-        MHD_stop_daemon(g_daemon);
-        g_daemon = NULL;
+    // 第二次收到信号时直接退出，避免卡死的脚本阻止进程停止
+    if (g_stop) {
+        _exit(1);
     }
-#endif
-    exit(0);
+    g_stop = 1;
 }
 
 // console.log 实现
 #ifdef QUICKJS_AVAILABLE
+static void append_console_output(struct js_exec_state* state, const char* str) {
+    if (!state) {
+        return;
+    }
+    // 检查缓冲区空间并安全追加到console_output
+    size_t current_len = strlen(state->console_output);
+    size_t remaining_space = sizeof(state->console_output) - current_len - 1;
+    if (remaining_space > 0) {
+        strncat(state->console_output, str, remaining_space);
+    }
+}
+
 static JSValue js_console_log(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     (void)this_val;
+    struct js_exec_state* state = JS_GetContextOpaque(ctx);
     for (int i = 0; i < argc; i++) {
         const char* str = JS_ToCString(ctx, argv[i]);
         if (str) {
             printf("%s", str);
-            // 检查缓冲区空间并安全追加到console_output
-            size_t current_len = strlen(console_output);
-            size_t remaining_space = sizeof(console_output) - current_len - 1;
-            if (remaining_space > 0) {
-                strncat(console_output, str, remaining_space);
-            }
+            append_console_output(state, str);
             JS_FreeCString(ctx, str);
         }
         if (i < argc - 1) {
             printf(" ");
-            size_t current_len = strlen(console_output);
-            size_t remaining_space = sizeof(console_output) - current_len - 1;
-            if (remaining_space > 0) {
-                strncat(console_output, " ", remaining_space);
-            }
+            append_console_output(state, " ");
         }
     }
     printf("\n");
-    size_t current_len = strlen(console_output);
-    size_t remaining_space = sizeof(console_output) - current_len - 1;
-    if (remaining_space > 0) {
-        strncat(console_output, "\n", remaining_space);
+    append_console_output(state, "\n");
+    return JS_UNDEFINED;
+}
+
+// 检查响应头名称/值中是否包含非法字符，防止头部注入
+static int is_valid_header_text(const char* text, int is_name) {
+    if (!text || (is_name && text[0] == '\0')) {
+        return 0;
+    }
+    for (const char* p = text; *p; p++) {
+        if (*p == '\r' || *p == '\n' || (is_name && (*p == ':' || *p == ' '))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// set_status(code) 实现：设置响应状态码
+static JSValue js_set_status(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    struct js_exec_state* state = JS_GetContextOpaque(ctx);
+    int32_t code;
+    if (argc < 1 || JS_ToInt32(ctx, &code, argv[0])) {
+        return JS_EXCEPTION;
+    }
+    if (code < 100 || code > 599) {
+        return JS_ThrowRangeError(ctx, "无效的状态码: %d", code);
+    }
+    if (state && state->response) {
+        state->response->status_code = code;
+    }
+    return JS_UNDEFINED;
+}
+
+// set_content_type(type) 实现：设置响应 Content-Type
+static JSValue js_set_content_type(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    struct js_exec_state* state = JS_GetContextOpaque(ctx);
+    if (argc < 1) {
+        return JS_ThrowTypeError(ctx, "缺少 content type 参数");
+    }
+    const char* type = JS_ToCString(ctx, argv[0]);
+    if (!type) {
+        return JS_EXCEPTION;
+    }
+    if (!is_valid_header_text(type, 0) || strlen(type) >= sizeof(state->response->content_type)) {
+        JS_FreeCString(ctx, type);
+        return JS_ThrowTypeError(ctx, "无效的 content type");
+    }
+    if (state && state->response) {
+        strcpy(state->response->content_type, type);
     }
+    JS_FreeCString(ctx, type);
     return JS_UNDEFINED;
 }
 
+// set_header(name, value) 实现：添加或覆盖响应头
+static JSValue js_set_header(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    struct js_exec_state* state = JS_GetContextOpaque(ctx);
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "用法: set_header(name, value)");
+    }
+    const char* name = JS_ToCString(ctx, argv[0]);
+    if (!name) {
+        return JS_EXCEPTION;
+    }
+    const char* value = JS_ToCString(ctx, argv[1]);
+    if (!value) {
+        JS_FreeCString(ctx, name);
+        return JS_EXCEPTION;
+    }
+
+    JSValue ret = JS_UNDEFINED;
+    struct script_response* resp = state ? state->response : NULL;
+    if (!is_valid_header_text(name, 1) || !is_valid_header_text(value, 0) ||
+        strlen(name) >= sizeof(resp->header_names[0]) || strlen(value) >= sizeof(resp->header_values[0])) {
+        ret = JS_ThrowTypeError(ctx, "无效的响应头: %s", name);
+    } else if (strcasecmp(name, "Content-Length") == 0 || strcasecmp(name, "Content-Encoding") == 0 ||
+               strcasecmp(name, "Transfer-Encoding") == 0 || strcasecmp(name, "Connection") == 0) {
+        // 这些头由服务器根据压缩和 keep-alive 协商结果生成
+        ret = JS_ThrowTypeError(ctx, "不允许脚本设置响应头: %s", name);
+    } else if (strcasecmp(name, "Content-Type") == 0) {
+        if (strlen(value) >= sizeof(resp->content_type)) {
+            ret = JS_ThrowTypeError(ctx, "无效的 content type");
+        } else if (resp) {
+            strcpy(resp->content_type, value);
+        }
+    } else if (resp) {
+        int idx = 0;
+        while (idx < resp->header_count && strcasecmp(resp->header_names[idx], name) != 0) {
+            idx++;
+        }
+        if (idx == MAX_SCRIPT_HEADERS) {
+            ret = JS_ThrowRangeError(ctx, "响应头数量超过限制: %d", MAX_SCRIPT_HEADERS);
+        } else {
+            strcpy(resp->header_names[idx], name);
+            strcpy(resp->header_values[idx], value);
+            if (idx == resp->header_count) {
+                resp->header_count++;
+            }
+        }
+    }
+
+    JS_FreeCString(ctx, name);
+    JS_FreeCString(ctx, value);
+    return ret;
+}
+
+// publish(topic, data) 实现：向订阅该主题的 SSE 客户端推送消息，非字符串数据按 JSON 发送
+static JSValue js_publish(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "用法: publish(topic, data)");
+    }
+    const char* topic = JS_ToCString(ctx, argv[0]);
+    if (!topic) {
+        return JS_EXCEPTION;
+    }
+    if (!is_valid_header_text(topic, 1) || strchr(topic, ',') != NULL) {
+        JSValue err = JS_ThrowTypeError(ctx, "无效的主题: %s", topic);
+        JS_FreeCString(ctx, topic);
+        return err;
+    }
+
+    JSValue str_val = JS_IsString(argv[1]) ? JS_DupValue(ctx, argv[1])
+                                           : JS_JSONStringify(ctx, argv[1], JS_UNDEFINED, JS_UNDEFINED);
+    if (JS_IsException(str_val)) {
+        JS_FreeCString(ctx, topic);
+        return JS_EXCEPTION;
+    }
+    const char* data = JS_ToCString(ctx, str_val);
+    JS_FreeValue(ctx, str_val);
+    if (!data) {
+        JS_FreeCString(ctx, topic);
+        return JS_EXCEPTION;
+    }
+
+    int delivered = sse_publish(topic, data);
+    JS_FreeCString(ctx, data);
+    JS_FreeCString(ctx, topic);
+    return JS_NewInt32(ctx, delivered);
+}
+
+// 将参数对象转换为 URL 查询字符串，与 HTTP 请求的 request_params 格式一致
+static JSValue params_to_query(JSContext *ctx, JSValueConst obj) {
+    static const char fn_src[] = "(function(o){return Object.keys(o).map(function(k){"
+                                 "return encodeURIComponent(k)+'='+encodeURIComponent(o[k]);}).join('&');})";
+    JSValue fn = JS_Eval(ctx, fn_src, sizeof(fn_src) - 1, "<params>", JS_EVAL_TYPE_GLOBAL);
+    if (JS_IsException(fn)) {
+        return fn;
+    }
+    JSValue ret = JS_Call(ctx, fn, JS_UNDEFINED, 1, &obj);
+    JS_FreeValue(ctx, fn);
+    return ret;
+}
+
+// 读取脚本参数：字符串直接使用，对象转换为查询字符串。返回 malloc 分配的字符串，出错返回 NULL
+static char* script_params_from_value(JSContext *ctx, JSValueConst value) {
+    if (JS_IsUndefined(value) || JS_IsNull(value)) {
+        return strdup("");
+    }
+    JSValue str_val = JS_IsObject(value) ? params_to_query(ctx, value) : JS_DupValue(ctx, value);
+    if (JS_IsException(str_val)) {
+        return NULL;
+    }
+    const char* str = JS_ToCString(ctx, str_val);
+    JS_FreeValue(ctx, str_val);
+    if (!str) {
+        return NULL;
+    }
+    char* params = strdup(str);
+    JS_FreeCString(ctx, str);
+    return params;
+}
+
+// 检查 worker 脚本名，拒绝访问 worker 目录以外的文件
+static int is_valid_script_name(const char* script) {
+    return script[0] != '\0' && script[0] != '/' && strstr(script, "..") == NULL;
+}
+
+// schedule(script, interval_seconds, params) 实现：定时执行 worker 脚本，返回任务 id
+static JSValue js_schedule(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    int32_t interval;
+    if (argc < 2) {
+        return JS_ThrowTypeError(ctx, "用法: schedule(script, interval_seconds, params)");
+    }
+    if (JS_ToInt32(ctx, &interval, argv[1])) {
+        return JS_EXCEPTION;
+    }
+    const char* script = JS_ToCString(ctx, argv[0]);
+    if (!script) {
+        return JS_EXCEPTION;
+    }
+    char* params = script_params_from_value(ctx, argc >= 3 ? argv[2] : JS_UNDEFINED);
+    if (!params) {
+        JS_FreeCString(ctx, script);
+        return JS_EXCEPTION;
+    }
+
+    JSValue ret;
+    int id = is_valid_script_name(script) ? schedule_script(script, interval, params) : -1;
+    if (id < 0) {
+        ret = JS_ThrowRangeError(ctx, "无法添加定时任务: %s", script);
+    } else {
+        ret = JS_NewInt32(ctx, id);
+    }
+    free(params);
+    JS_FreeCString(ctx, script);
+    return ret;
+}
+
+// unschedule(id) 实现：取消定时任务
+static JSValue js_unschedule(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    int32_t id;
+    if (argc < 1 || JS_ToInt32(ctx, &id, argv[0])) {
+        return JS_EXCEPTION;
+    }
+    return JS_NewBool(ctx, unschedule_script(id));
+}
+
 // shell_exec 实现
 static JSValue js_shell_exec(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
     (void)this_val;
@@ -214,23 +485,59 @@ char* https_request(const char* host, const char* path, int port) {
 
 // 执行 JavaScript 代码并返回结果
 #ifdef QUICKJS_AVAILABLE
-char* execute_javascript(const char* js_code, const char* filename, const char* params) {
-    // 清空console输出
-    memset(console_output, 0, sizeof(console_output));
-    
-    JSRuntime* rt = JS_NewRuntime();
-    if (!rt) {
-        return strdup("无法创建 JS 运行时");
+// 每个线程复用 JS 运行时，每次执行只创建新的上下文。
+// QuickJS 运行时不能跨线程使用，因此按线程而不是全局复用。
+// invoke() 的每一层嵌套使用单独的运行时，被调用脚本的 Promise 任务与调用方互不干扰
+static __thread JSRuntime* thread_runtimes[MAX_INVOKE_DEPTH + 1];
+
+static JSRuntime* get_thread_runtime(int depth) {
+    if (!thread_runtimes[depth]) {
+        thread_runtimes[depth] = JS_NewRuntime();
+        if (thread_runtimes[depth]) {
+            // 设置模块加载器
+            JS_SetModuleLoaderFunc(thread_runtimes[depth], NULL, NULL, NULL);
+        }
     }
-    
+    return thread_runtimes[depth];
+}
+
+// 线程退出前释放本线程的 JS 运行时
+static void release_thread_runtimes(void) {
+    for (int i = 0; i <= MAX_INVOKE_DEPTH; i++) {
+        if (thread_runtimes[i]) {
+            JS_FreeRuntime(thread_runtimes[i]);
+            thread_runtimes[i] = NULL;
+        }
+    }
+}
+
+static JSValue js_invoke(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv);
+
+// 执行完运行时中所有待处理的 Promise 任务。运行时被复用，遗留的任务会一直引用已释放的上下文，
+// JS_RunGC 也无法回收，因此每次执行后都要清空
+static void run_pending_jobs(JSRuntime* rt) {
+    JSContext* job_ctx;
+    int ret;
+    while ((ret = JS_ExecutePendingJob(rt, &job_ctx)) != 0) {
+        if (ret < 0) {
+            JSValue exception = JS_GetException(job_ctx);
+            const char* error_str = JS_ToCString(job_ctx, exception);
+            printf("Promise 任务执行异常: %s\n", error_str ? error_str : "unknown error");
+            if (error_str) {
+                JS_FreeCString(job_ctx, error_str);
+            }
+            JS_FreeValue(job_ctx, exception);
+        }
+    }
+}
+
+// 创建脚本执行上下文，注册全局对象和函数
+static JSContext* new_script_context(JSRuntime* rt, struct js_exec_state* state, const char* params) {
     JSContext* ctx = JS_NewContext(rt);
     if (!ctx) {
-        JS_FreeRuntime(rt);
-        return strdup("无法创建 JS 上下文");
+        return NULL;
     }
-    
-    // 设置模块加载器
-    JS_SetModuleLoaderFunc(rt, NULL, NULL, NULL);
+    JS_SetContextOpaque(ctx, state);
     
     // 添加 console 对象
     JSValue global_obj = JS_GetGlobalObject(ctx);
@@ -242,6 +549,26 @@ char* execute_javascript(const char* js_code, const char* filename, const char*
     JS_SetPropertyStr(ctx, global_obj, "shell_exec", 
         JS_NewCFunction(ctx, js_shell_exec, "shell_exec", 1));
     
+    // 添加响应控制函数到全局对象
+    JS_SetPropertyStr(ctx, global_obj, "set_status",
+        JS_NewCFunction(ctx, js_set_status, "set_status", 1));
+    JS_SetPropertyStr(ctx, global_obj, "set_header",
+        JS_NewCFunction(ctx, js_set_header, "set_header", 2));
+    JS_SetPropertyStr(ctx, global_obj, "set_content_type",
+        JS_NewCFunction(ctx, js_set_content_type, "set_content_type", 1));
+    
+    // 添加 SSE 推送函数到全局对象
+    JS_SetPropertyStr(ctx, global_obj, "publish",
+        JS_NewCFunction(ctx, js_publish, "publish", 2));
+    
+    // 添加脚本调用和定时任务函数到全局对象
+    JS_SetPropertyStr(ctx, global_obj, "invoke",
+        JS_NewCFunction(ctx, js_invoke, "invoke", 2));
+    JS_SetPropertyStr(ctx, global_obj, "schedule",
+        JS_NewCFunction(ctx, js_schedule, "schedule", 3));
+    JS_SetPropertyStr(ctx, global_obj, "unschedule",
+        JS_NewCFunction(ctx, js_unschedule, "unschedule", 1));
+    
     // 添加 request_params 变量到全局对象
     if (params && strlen(params) > 0) {
         JS_SetPropertyStr(ctx, global_obj, "request_params", JS_NewString(ctx, params));
@@ -250,19 +577,153 @@ char* execute_javascript(const char* js_code, const char* filename, const char*
     }
     
     JS_FreeValue(ctx, global_obj);
+    return ctx;
+}
+
+// 将被调用脚本的返回值转换到调用方上下文，可 JSON 序列化的值保持结构，其余转为字符串
+static JSValue transfer_return_value(JSContext* from, JSContext* to, JSValueConst val, const char* filename) {
+    if (JS_IsUndefined(val)) {
+        return JS_UNDEFINED;
+    }
+    JSValue json = JS_JSONStringify(from, val, JS_UNDEFINED, JS_UNDEFINED);
+    if (JS_IsException(json)) {
+        JS_FreeValue(from, JS_GetException(from));
+    } else if (!JS_IsUndefined(json)) {
+        size_t len;
+        const char* json_str = JS_ToCStringLen(from, &len, json);
+        JS_FreeValue(from, json);
+        if (json_str) {
+            JSValue parsed = JS_ParseJSON(to, json_str, len, filename);
+            JS_FreeCString(from, json_str);
+            if (!JS_IsException(parsed)) {
+                return parsed;
+            }
+            JS_FreeValue(to, JS_GetException(to));
+        }
+    }
+    const char* str = JS_ToCString(from, val);
+    JSValue ret = str ? JS_NewString(to, str) : JS_UNDEFINED;
+    if (str) {
+        JS_FreeCString(from, str);
+    }
+    return ret;
+}
+
+// invoke(script, params) 实现：在当前线程复用的运行时中执行另一个 worker 脚本，
+// 返回 {success, return, console, status, error}
+static JSValue js_invoke(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    (void)this_val;
+    struct js_exec_state* parent = JS_GetContextOpaque(ctx);
+    int depth = (parent ? parent->invoke_depth : 0) + 1;
+    if (argc < 1) {
+        return JS_ThrowTypeError(ctx, "用法: invoke(script, params)");
+    }
+    if (depth > MAX_INVOKE_DEPTH) {
+        return JS_ThrowRangeError(ctx, "invoke 嵌套层数超过限制: %d", MAX_INVOKE_DEPTH);
+    }
+
+    const char* script = JS_ToCString(ctx, argv[0]);
+    if (!script) {
+        return JS_EXCEPTION;
+    }
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/worker/%s", worker_dir, script);
+    int valid_name = is_valid_script_name(script);
+    JS_FreeCString(ctx, script);
+    char* js_code = valid_name ? read_file_content(filepath) : NULL;
+    if (!js_code) {
+        return JS_ThrowReferenceError(ctx, "JS文件不存在: %s", filepath);
+    }
+    char* params = script_params_from_value(ctx, argc >= 2 ? argv[1] : JS_UNDEFINED);
+    if (!params) {
+        free(js_code);
+        return JS_EXCEPTION;
+    }
+
+    struct script_response child_resp;
+    memset(&child_resp, 0, sizeof(child_resp));
+    struct js_exec_state* child = calloc(1, sizeof(struct js_exec_state));
+    JSRuntime* child_rt = get_thread_runtime(depth);
+    JSContext* child_ctx = child && child_rt ? new_script_context(child_rt, child, params) : NULL;
+    free(params);
+    if (!child_ctx) {
+        free(child);
+        free(js_code);
+        return JS_ThrowInternalError(ctx, "无法创建 JS 上下文");
+    }
+    child->response = &child_resp;
+    child->invoke_depth = depth;
+
+    JSValue val = JS_Eval(child_ctx, js_code, strlen(js_code), filepath, JS_EVAL_TYPE_GLOBAL);
+    // 子运行时只包含 child_ctx 的任务，调用方的 Promise 任务留给调用方自己执行
+    run_pending_jobs(child_rt);
+    free(js_code);
+
+    JSValue result = JS_NewObject(ctx);
+    if (JS_IsException(val)) {
+        JSValue exception = JS_GetException(child_ctx);
+        const char* error_str = JS_ToCString(child_ctx, exception);
+        JS_SetPropertyStr(ctx, result, "success", JS_NewBool(ctx, 0));
+        JS_SetPropertyStr(ctx, result, "error", JS_NewString(ctx, error_str ? error_str : "unknown error"));
+        if (error_str) {
+            JS_FreeCString(child_ctx, error_str);
+        }
+        JS_FreeValue(child_ctx, exception);
+    } else {
+        JS_SetPropertyStr(ctx, result, "success", JS_NewBool(ctx, 1));
+        JS_SetPropertyStr(ctx, result, "return", transfer_return_value(child_ctx, ctx, val, filepath));
+    }
+    JS_SetPropertyStr(ctx, result, "console", JS_NewString(ctx, child->console_output));
+    JS_SetPropertyStr(ctx, result, "status", JS_NewInt32(ctx, child_resp.status_code ? child_resp.status_code : 200));
+
+    JS_FreeValue(child_ctx, val);
+    JS_FreeContext(child_ctx);
+    JS_RunGC(child_rt);
+    free(child);
+    return result;
+}
+
+// 执行 JavaScript 代码：返回值转换为字符串返回（返回 undefined 时为 NULL，异常时为错误信息），
+// console 输出通过 console_output 单独返回，均由调用方释放
+char* execute_javascript(const char* js_code, const char* filename, const char* params,
+                         struct script_response* response, char** console_output) {
+    *console_output = NULL;
+    // 每次执行使用独立的状态，避免并发请求之间互相覆盖console输出
+    struct js_exec_state* state = calloc(1, sizeof(struct js_exec_state));
+    if (!state) {
+        return strdup("内存分配失败");
+    }
+    state->response = response;
+    
+    JSRuntime* rt = get_thread_runtime(0);
+    if (!rt) {
+        free(state);
+        return strdup("无法创建 JS 运行时");
+    }
+    
+    JSContext* ctx = new_script_context(rt, state, params);
+    if (!ctx) {
+        free(state);
+        return strdup("无法创建 JS 上下文");
+    }
     
     // 执行 JavaScript 代码
     JSValue val = JS_Eval(ctx, js_code, strlen(js_code), filename, JS_EVAL_TYPE_GLOBAL);
+    run_pending_jobs(rt);
     
     if (JS_IsException(val)) {
         JSValue exception = JS_GetException(ctx);
         const char* error_str = JS_ToCString(ctx, exception);
-        char* result = strdup(error_str);
-        JS_FreeCString(ctx, error_str);
+        char* result = strdup(error_str ? error_str : "unknown error");
+        if (error_str) {
+            JS_FreeCString(ctx, error_str);
+        }
         JS_FreeValue(ctx, exception);
         JS_FreeValue(ctx, val);
         JS_FreeContext(ctx);
-        JS_FreeRuntime(rt);
+        JS_RunGC(rt);
+        *console_output = strdup(state->console_output);
+        free(state);
         return result;
     }
     
@@ -273,27 +734,22 @@ char* execute_javascript(const char* js_code, const char* filename, const char*
         if (result_str) {
             result = strdup(result_str);
             JS_FreeCString(ctx, result_str);
-        } else {
-            result = strdup("undefined");
         }
-    } else {
-        result = strdup("undefined");
     }
     
-    // 组合console输出和返回值
-    char* final_result = malloc(strlen(result) + strlen(console_output) + 100);
-    snprintf(final_result, strlen(result) + strlen(console_output) + 100,
-        "{\"return\":\"%s\",\"console\":\"%s\"}", result, console_output);
-    
-    free(result);
     JS_FreeValue(ctx, val);
     JS_FreeContext(ctx);
-    JS_FreeRuntime(rt);
-    return final_result;
+    // 运行时被复用，及时回收本次执行产生的循环引用对象
+    JS_RunGC(rt);
+    *console_output = strdup(state->console_output);
+    free(state);
+    return result;
 }
 #else
 // 当QuickJS不可用时的占位函数
-char* execute_javascript(const char* js_code, const char* filename, const char* params) {
+char* execute_javascript(const char* js_code, const char* filename, const char* params,
+                         struct script_response* response, char** console_output) {
+    *console_output = NULL;
     return strdup("QuickJS 功能不可用");
 }
 #endif
@@ -347,91 +803,1322 @@ static int build_query_string(void *cls, enum MHD_ValueKind kind, const char *ke
 }
 
 #ifdef MICROHTTPD_AVAILABLE
-// POST数据结构
+struct script_job;
+
+// POST数据结构，同时作为单个请求的状态
 struct post_data {
     char* data;
     size_t size;
     size_t allocated;
+    struct script_job* job; // 正在执行的脚本任务，连接在执行期间处于挂起状态
 };
 
-// HTTP 请求处理函数
-static enum MHD_Result request_handler(void *cls, struct MHD_Connection *connection,
-                          const char *url, const char *method,
-                          const char *version, const char *upload_data,
-                          size_t *upload_data_size, void **con_cls) {
-    struct post_data* post = *con_cls;
-    struct MHD_Response *response;
-    int ret;
-    
-    if (post == NULL) {
-        post = malloc(sizeof(struct post_data));
-        post->data = NULL;
-        post->size = 0;
-        post->allocated = 0;
-        *con_cls = post;
-        printf("开始处理请求\n");
-        return MHD_YES;
+// 预先生成压缩版本的缓存响应体，压缩开销只在首次使用时付出一次
+struct cached_body {
+    const char* data;
+    size_t len;
+    char* gzip_data;
+    size_t gzip_len;
+    char* deflate_data;
+    size_t deflate_len;
+};
+
+static const char index_html[] = "<!DOCTYPE html>\n"
+                                 "<html><head><title>JS执行器</title></head>\n"
+                                 "<body><h1>JS执行器</h1>\n"
+                                 "<p>访问任意路径来执行worker目录下的JS文件</p>\n"
+                                 "</body></html>";
+static struct cached_body index_body;
+static pthread_once_t index_body_once = PTHREAD_ONCE_INIT;
+
+#ifdef ZLIB_AVAILABLE
+enum content_encoding {
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_DEFLATE
+};
+
+// 判断内容类型是否值得压缩（文本类内容）
+static int is_compressible_type(const char* content_type) {
+    if (!content_type) {
+        return 0;
     }
-    
-    // 对于POST请求，需要等待数据接收完成
-    if (0 != *upload_data_size) {
-        printf("接收POST数据: %zu bytes\n", *upload_data_size);
-        
-        // 分配内存并复制数据
-        size_t new_size = post->size + *upload_data_size + 1;
-        
-        // 检查总大小限制
-        if (new_size > 1024 * 1024) { // 1MB限制
-            printf("POST数据过大: %zu bytes\n", new_size);
-            *upload_data_size = 0;
-            return MHD_YES;
+    if (strncasecmp(content_type, "text/", 5) == 0) {
+        return 1;
+    }
+    return strcasestr(content_type, "json") != NULL ||
+           strcasestr(content_type, "javascript") != NULL ||
+           strcasestr(content_type, "xml") != NULL;
+}
+
+// 取 Accept-Encoding 中指定编码的 q 值，未出现时返回 -1（"*" 作为兜底）
+static double accept_encoding_q(const char* header, const char* coding) {
+    double star_q = -1;
+    size_t coding_len = strlen(coding);
+    const char* p = header;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
         }
-        
-        if (new_size > post->allocated) {
-            char* new_data = realloc(post->data, new_size);
-            if (new_data) {
-                post->data = new_data;
-                post->allocated = new_size;
+        if (*p == '\0') {
+            break;
+        }
+        const char* name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        size_t name_len = p - name;
+        double q = 1.0;
+        while (*p && *p != ',') {
+            if (*p == ';') {
+                p++;
+                while (*p == ' ' || *p == '\t') {
+                    p++;
+                }
+                if ((*p == 'q' || *p == 'Q') && p[1] == '=') {
+                    q = strtod(p + 2, NULL);
+                }
             } else {
-                printf("内存分配失败\n");
-                *upload_data_size = 0;
-                return MHD_YES;
+                p++;
             }
         }
-        
-        memcpy(post->data + post->size, upload_data, *upload_data_size);
-        post->size += *upload_data_size;
-        post->data[post->size] = '\0';
-        
-        *upload_data_size = 0;
-        return MHD_YES;
+        if (name_len == coding_len && strncasecmp(name, coding, name_len) == 0) {
+            return q;
+        }
+        if (name_len == 1 && name[0] == '*') {
+            star_q = q;
+        }
     }
-    
-    printf("请求处理完成，开始响应\n");
-    if (post->data) {
-        printf("POST数据: %s\n", post->data);
+    return star_q;
+}
+
+// 根据 Accept-Encoding 选择响应编码，gzip 优先
+static enum content_encoding negotiate_encoding(struct MHD_Connection* connection) {
+    const char* accept = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+    if (!accept) {
+        return ENCODING_IDENTITY;
     }
-    *con_cls = NULL;
-    
-    char* response_data = NULL;
-    int status_code = 200;
-    
-    printf("收到请求: %s %s\n", method, url);
-    
-    // 处理根路径
-    if (strcmp(url, "/") == 0) {
-        response_data = strdup("<!DOCTYPE html>\n"
-                              "<html><head><title>JS执行器</title></head>\n"
-                              "<body><h1>JS执行器</h1>\n"
-                              "<p>访问任意路径来执行worker目录下的JS文件</p>\n"
-                              "</body></html>");
+    double gzip_q = accept_encoding_q(accept, "gzip");
+    double deflate_q = accept_encoding_q(accept, "deflate");
+    if (gzip_q > 0 && gzip_q >= deflate_q) {
+        return ENCODING_GZIP;
     }
-    // 处理所有其他请求，都当作JS文件执行
-    else {
-        const char* js_file = url + 1; // 跳过开头的 "/"
-        
-        // 获取查询参数
-        char params_buffer[1024] = "";
+    if (deflate_q > 0) {
+        return ENCODING_DEFLATE;
+    }
+    return ENCODING_IDENTITY;
+}
+
+// 压缩响应体，返回 malloc 分配的缓冲区，失败返回 NULL
+static char* compress_body(const char* data, size_t len, enum content_encoding encoding, size_t* out_len) {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    // windowBits 加 16 输出 gzip 格式，否则为 HTTP deflate 所用的 zlib 格式
+    int window_bits = (encoding == ENCODING_GZIP) ? 15 + 16 : 15;
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    uLong bound = deflateBound(&strm, len);
+    char* out = malloc(bound);
+    if (!out) {
+        deflateEnd(&strm);
+        return NULL;
+    }
+    strm.next_in = (Bytef*)data;
+    strm.avail_in = len;
+    strm.next_out = (Bytef*)out;
+    strm.avail_out = bound;
+    int ret = deflate(&strm, Z_FINISH);
+    *out_len = strm.total_out;
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+#endif
+
+// 初始化缓存响应体，压缩后不比原文小的版本直接丢弃
+static void cached_body_init(struct cached_body* body, const char* data) {
+    memset(body, 0, sizeof(*body));
+    body->data = data;
+    body->len = strlen(data);
+#ifdef ZLIB_AVAILABLE
+    body->gzip_data = compress_body(data, body->len, ENCODING_GZIP, &body->gzip_len);
+    if (body->gzip_data && body->gzip_len >= body->len) {
+        free(body->gzip_data);
+        body->gzip_data = NULL;
+    }
+    body->deflate_data = compress_body(data, body->len, ENCODING_DEFLATE, &body->deflate_len);
+    if (body->deflate_data && body->deflate_len >= body->len) {
+        free(body->deflate_data);
+        body->deflate_data = NULL;
+    }
+#endif
+}
+
+static void init_index_body(void) {
+    cached_body_init(&index_body, index_html);
+}
+
+// 检查脚本是否设置了指定响应头
+static int has_script_header(const struct script_response* script_resp, const char* name) {
+    if (!script_resp) {
+        return 0;
+    }
+    for (int i = 0; i < script_resp->header_count; i++) {
+        if (strcasecmp(script_resp->header_names[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 添加响应头：内容类型、压缩编码、CORS 以及脚本设置的响应头
+static void add_response_headers(struct MHD_Response* response, const char* content_type,
+                                 const char* content_encoding, int vary,
+                                 const struct script_response* script_resp) {
+    MHD_add_response_header(response, "Content-Type", content_type);
+    if (content_encoding) {
+        MHD_add_response_header(response, "Content-Encoding", content_encoding);
+    }
+    if (vary) {
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    }
+    if (!has_script_header(script_resp, "Access-Control-Allow-Origin")) {
+        MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    }
+    if (script_resp) {
+        for (int i = 0; i < script_resp->header_count; i++) {
+            MHD_add_response_header(response, script_resp->header_names[i], script_resp->header_values[i]);
+        }
+    }
+}
+
+// 发送动态响应，body 必须由 malloc 分配，所有权转移给此函数
+// 客户端支持时对较大的文本响应进行 gzip/deflate 压缩
+static enum MHD_Result queue_body_response(struct MHD_Connection* connection, unsigned int status_code,
+                                           const char* content_type, char* body, size_t len,
+                                           const struct script_response* script_resp) {
+    const char* content_encoding = NULL;
+    int vary = 0;
+#ifdef ZLIB_AVAILABLE
+    if (len >= COMPRESS_MIN_SIZE && is_compressible_type(content_type)) {
+        vary = 1;
+        enum content_encoding encoding = negotiate_encoding(connection);
+        if (encoding != ENCODING_IDENTITY) {
+            size_t compressed_len = 0;
+            char* compressed = compress_body(body, len, encoding, &compressed_len);
+            if (compressed && compressed_len < len) {
+                free(body);
+                body = compressed;
+                len = compressed_len;
+                content_encoding = (encoding == ENCODING_GZIP) ? "gzip" : "deflate";
+            } else {
+                free(compressed);
+            }
+        }
+    }
+#endif
+    struct MHD_Response* response = MHD_create_response_from_buffer(len, body, MHD_RESPMEM_MUST_FREE);
+    if (!response) {
+        free(body);
+        return MHD_NO;
+    }
+    add_response_headers(response, content_type, content_encoding, vary, script_resp);
+    enum MHD_Result ret = MHD_queue_response(connection, status_code, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// 发送 JSON 格式的错误信息，内存分配失败时返回 MHD_NO 由 MHD 关闭连接
+static enum MHD_Result queue_json_message(struct MHD_Connection* connection, unsigned int status_code,
+                                          const char* msg) {
+    char* body = strdup(msg);
+    if (!body) {
+        return MHD_NO;
+    }
+    return queue_body_response(connection, status_code, CONTENT_TYPE_JSON, body, strlen(body), NULL);
+}
+
+// 发送缓存响应，直接引用预压缩的缓冲区，不做复制
+static enum MHD_Result queue_cached_response(struct MHD_Connection* connection, unsigned int status_code,
+                                             const char* content_type, const struct cached_body* body) {
+    const char* data = body->data;
+    size_t len = body->len;
+    const char* content_encoding = NULL;
+    int vary = 0;
+#ifdef ZLIB_AVAILABLE
+    vary = (body->gzip_data != NULL || body->deflate_data != NULL);
+    enum content_encoding encoding = vary ? negotiate_encoding(connection) : ENCODING_IDENTITY;
+    if (encoding == ENCODING_GZIP && body->gzip_data) {
+        data = body->gzip_data;
+        len = body->gzip_len;
+        content_encoding = "gzip";
+    } else if (encoding == ENCODING_DEFLATE && body->deflate_data) {
+        data = body->deflate_data;
+        len = body->deflate_len;
+        content_encoding = "deflate";
+    }
+#endif
+    struct MHD_Response* response = MHD_create_response_from_buffer(len, (void*)data, MHD_RESPMEM_PERSISTENT);
+    if (!response) {
+        return MHD_NO;
+    }
+    add_response_headers(response, content_type, content_encoding, vary, NULL);
+    enum MHD_Result ret = MHD_queue_response(connection, status_code, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+
+// 已打开静态文件的缓存项。fd 由 full_response 持有，响应被最后一个连接释放时关闭，
+// 因此淘汰缓存项时不会影响正在发送该文件的连接
+struct fd_cache_entry {
+    char path[512];
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    int fd;
+    struct MHD_Response* full_response; // 完整文件的 200 响应，多个连接共享
+    const char* content_type;
+    char etag[64];
+    char last_modified[64];
+    unsigned long last_used;
+};
+
+static struct fd_cache_entry fd_cache[FD_CACHE_SIZE];
+static unsigned long fd_cache_clock = 0;
+static pthread_mutex_t fd_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct {
+    const char* ext;
+    const char* type;
+} mime_types[] = {
+    { "html", CONTENT_TYPE_HTML },
+    { "htm", CONTENT_TYPE_HTML },
+    { "css", "text/css; charset=utf-8" },
+    { "js", "application/javascript; charset=utf-8" },
+    { "mjs", "application/javascript; charset=utf-8" },
+    { "json", CONTENT_TYPE_JSON },
+    { "map", CONTENT_TYPE_JSON },
+    { "txt", "text/plain; charset=utf-8" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "ico", "image/x-icon" },
+    { "webp", "image/webp" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "ttf", "font/ttf" },
+    { "wasm", "application/wasm" },
+    { "pdf", "application/pdf" },
+    { "zip", "application/zip" },
+    { "gz", "application/gzip" },
+    { "tar", "application/x-tar" },
+};
+
+// 根据扩展名获取内容类型，未知类型按二进制处理
+static const char* mime_type_for_path(const char* path) {
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    if (dot && (!slash || dot > slash)) {
+        for (size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
+            if (strcasecmp(dot + 1, mime_types[i].ext) == 0) {
+                return mime_types[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// 检查静态文件相对路径，拒绝 ".." 路径段，防止访问挂载目录以外的文件
+static int is_safe_static_path(const char* rel_path) {
+    const char* p = rel_path;
+    while (*p) {
+        const char* seg_end = strchr(p, '/');
+        size_t seg_len = seg_end ? (size_t)(seg_end - p) : strlen(p);
+        if (seg_len == 2 && p[0] == '.' && p[1] == '.') {
+            return 0;
+        }
+        if (!seg_end) {
+            break;
+        }
+        p = seg_end + 1;
+    }
+    return strchr(rel_path, '\\') == NULL;
+}
+
+static void fd_cache_evict(struct fd_cache_entry* entry) {
+    if (entry->full_response) {
+        MHD_destroy_response(entry->full_response);
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->fd = -1;
+}
+
+// 查找或打开静态文件，需持有 fd_cache_mutex。文件被替换（inode、大小或修改时间变化）时重新打开
+static struct fd_cache_entry* fd_cache_get(const char* path, const struct stat* st) {
+    struct fd_cache_entry* victim = &fd_cache[0];
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        struct fd_cache_entry* entry = &fd_cache[i];
+        if (entry->full_response && strcmp(entry->path, path) == 0) {
+            if (entry->dev == st->st_dev && entry->ino == st->st_ino && entry->size == st->st_size &&
+                entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+                entry->last_used = ++fd_cache_clock;
+                return entry;
+            }
+            fd_cache_evict(entry);
+            victim = entry;
+            break;
+        }
+        if (!entry->full_response) {
+            victim = entry;
+        } else if (victim->full_response && entry->last_used < victim->last_used) {
+            victim = entry;
+        }
+    }
+    if (victim->full_response) {
+        fd_cache_evict(victim);
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat fst;
+    if (fstat(fd, &fst) != 0 || !S_ISREG(fst.st_mode)) {
+        close(fd);
+        return NULL;
+    }
+    struct MHD_Response* response = MHD_create_response_from_fd64((uint64_t)fst.st_size, fd);
+    if (!response) {
+        close(fd);
+        return NULL;
+    }
+
+    struct fd_cache_entry* entry = victim;
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->dev = fst.st_dev;
+    entry->ino = fst.st_ino;
+    entry->size = fst.st_size;
+    entry->mtime = fst.st_mtim;
+    entry->fd = fd;
+    entry->full_response = response;
+    entry->content_type = mime_type_for_path(path);
+    snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx-%lx\"",
+             (unsigned long long)fst.st_ino, (unsigned long long)fst.st_size,
+             (unsigned long)(fst.st_mtim.tv_sec ^ fst.st_mtim.tv_nsec));
+    struct tm tm_buf;
+    strftime(entry->last_modified, sizeof(entry->last_modified), "%a, %d %b %Y %H:%M:%S GMT",
+             gmtime_r(&fst.st_mtim.tv_sec, &tm_buf));
+    entry->last_used = ++fd_cache_clock;
+
+    MHD_add_response_header(response, "Content-Type", entry->content_type);
+    MHD_add_response_header(response, "ETag", entry->etag);
+    MHD_add_response_header(response, "Last-Modified", entry->last_modified);
+    MHD_add_response_header(response, "Accept-Ranges", "bytes");
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    return entry;
+}
+
+// 文件已不存在时释放对应缓存项，避免已删除的大文件一直占用磁盘空间
+static void fd_cache_forget(const char* path) {
+    pthread_mutex_lock(&fd_cache_mutex);
+    for (int i = 0; i < FD_CACHE_SIZE; i++) {
+        if (fd_cache[i].full_response && strcmp(fd_cache[i].path, path) == 0) {
+            fd_cache_evict(&fd_cache[i]);
+        }
+    }
+    pthread_mutex_unlock(&fd_cache_mutex);
+}
+
+// 解析单段 Range 头（bytes=a-b / a- / -n）。
+// 返回 1 表示范围有效，0 表示忽略 Range 返回完整内容，-1 表示范围不可满足
+static int parse_range(const char* header, uint64_t size, uint64_t* start, uint64_t* end) {
+    if (strncasecmp(header, "bytes=", 6) != 0 || strchr(header, ',') != NULL) {
+        return 0; // 不支持的单位或多段范围，按完整内容响应
+    }
+    const char* p = header + 6;
+    while (*p == ' ') {
+        p++;
+    }
+    char* tail;
+    if (*p == '-') {
+        if (!isdigit((unsigned char)p[1])) {
+            return 0;
+        }
+        uint64_t suffix = strtoull(p + 1, &tail, 10);
+        if (suffix == 0 || size == 0) {
+            return -1;
+        }
+        *start = suffix >= size ? 0 : size - suffix;
+        *end = size - 1;
+    } else {
+        if (!isdigit((unsigned char)*p)) {
+            return 0;
+        }
+        *start = strtoull(p, &tail, 10);
+        if (*tail != '-') {
+            return 0;
+        }
+        p = tail + 1;
+        if (isdigit((unsigned char)*p)) {
+            *end = strtoull(p, &tail, 10);
+            if (*end < *start) {
+                return 0;
+            }
+        } else {
+            *end = UINT64_MAX;
+            tail = (char*)p;
+        }
+        if (*start >= size) {
+            return -1;
+        }
+        if (*end >= size) {
+            *end = size - 1;
+        }
+    }
+    while (*tail == ' ') {
+        tail++;
+    }
+    return *tail == '\0' ? 1 : 0;
+}
+
+// 判断条件请求是否命中（If-None-Match 优先于 If-Modified-Since）
+static int is_not_modified(struct MHD_Connection* connection, const struct fd_cache_entry* entry) {
+    const char* if_none_match = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-None-Match");
+    if (if_none_match) {
+        return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, entry->etag) != NULL;
+    }
+    const char* if_modified_since = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-Modified-Since");
+    if (if_modified_since) {
+        struct tm tm_buf;
+        memset(&tm_buf, 0, sizeof(tm_buf));
+        if (strptime(if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm_buf)) {
+            return timegm(&tm_buf) >= entry->mtime.tv_sec;
+        }
+    }
+    return 0;
+}
+
+// If-Range 与当前文件不一致时忽略 Range，返回完整的新内容
+static int is_range_allowed(struct MHD_Connection* connection, const struct fd_cache_entry* entry) {
+    const char* if_range = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "If-Range");
+    if (!if_range) {
+        return 1;
+    }
+    if (if_range[0] == '"') {
+        return strcmp(if_range, entry->etag) == 0;
+    }
+    return strcmp(if_range, entry->last_modified) == 0;
+}
+
+// 发送不带内容的响应（304/416 等），附加校验头
+static enum MHD_Result queue_empty_response(struct MHD_Connection* connection, unsigned int status_code,
+                                            const struct fd_cache_entry* entry, const char* content_range) {
+    struct MHD_Response* response = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
+    if (!response) {
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, "ETag", entry->etag);
+    MHD_add_response_header(response, "Last-Modified", entry->last_modified);
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+    if (content_range) {
+        MHD_add_response_header(response, "Content-Range", content_range);
+    }
+    enum MHD_Result ret = MHD_queue_response(connection, status_code, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// 静态文件请求处理：通过 sendfile 直接从文件描述符发送，不经过用户态缓冲区和 JS 引擎
+static enum MHD_Result handle_static_request(struct MHD_Connection* connection, const char* method,
+                                             const char* rel_path) {
+    char msg[700];
+    if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0) {
+        snprintf(msg, sizeof(msg), "{\"status\":\"error\",\"message\":\"静态文件不支持该请求方法: %s\"}", method);
+        return queue_json_message(connection, 405, msg);
+    }
+
+    char filepath[512];
+    int path_len = snprintf(filepath, sizeof(filepath), "%s/%s/%s%s", worker_dir, STATIC_DIR_NAME, rel_path,
+                            (rel_path[0] == '\0' || rel_path[strlen(rel_path) - 1] == '/') ? "index.html" : "");
+    struct stat st;
+    if (!is_safe_static_path(rel_path) || path_len >= (int)sizeof(filepath) ||
+        stat(filepath, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fd_cache_forget(filepath);
+        snprintf(msg, sizeof(msg), "{\"status\":\"error\",\"message\":\"文件不存在: %s\"}", filepath);
+        return queue_json_message(connection, 404, msg);
+    }
+
+    enum MHD_Result ret;
+    pthread_mutex_lock(&fd_cache_mutex);
+    struct fd_cache_entry* entry = fd_cache_get(filepath, &st);
+    if (!entry) {
+        pthread_mutex_unlock(&fd_cache_mutex);
+        snprintf(msg, sizeof(msg), "{\"status\":\"error\",\"message\":\"无法打开文件: %s\"}", filepath);
+        return queue_json_message(connection, 500, msg);
+    }
+
+    uint64_t size = (uint64_t)entry->size;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    const char* range = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Range");
+    int range_result = (range && is_range_allowed(connection, entry)) ? parse_range(range, size, &start, &end) : 0;
+    char content_range[96];
+
+    if (is_not_modified(connection, entry)) {
+        ret = queue_empty_response(connection, 304, entry, NULL);
+    } else if (range_result < 0) {
+        snprintf(content_range, sizeof(content_range), "bytes */%llu", (unsigned long long)size);
+        ret = queue_empty_response(connection, 416, entry, content_range);
+    } else if (range_result > 0) {
+        // 部分内容使用 dup 出的描述符，由该响应独立持有
+        struct MHD_Response* response = NULL;
+        int fd = dup(entry->fd);
+        if (fd >= 0) {
+            response = MHD_create_response_from_fd_at_offset64(end - start + 1, fd, start);
+            if (!response) {
+                close(fd);
+            }
+        }
+        if (response) {
+            snprintf(content_range, sizeof(content_range), "bytes %llu-%llu/%llu",
+                     (unsigned long long)start, (unsigned long long)end, (unsigned long long)size);
+            MHD_add_response_header(response, "Content-Type", entry->content_type);
+            MHD_add_response_header(response, "Content-Range", content_range);
+            MHD_add_response_header(response, "ETag", entry->etag);
+            MHD_add_response_header(response, "Last-Modified", entry->last_modified);
+            MHD_add_response_header(response, "Accept-Ranges", "bytes");
+            MHD_add_response_header(response, "Cache-Control", "no-cache");
+            MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+            ret = MHD_queue_response(connection, 206, response);
+            MHD_destroy_response(response);
+        } else {
+            ret = MHD_NO;
+        }
+    } else {
+        ret = MHD_queue_response(connection, 200, entry->full_response);
+    }
+    pthread_mutex_unlock(&fd_cache_mutex);
+    return ret;
+}
+
+// SSE 订阅者。连接由事件循环线程处理：没有待发送数据时挂起连接，
+// 有新消息时恢复，因此空闲的订阅者不占用任何线程
+struct sse_subscriber {
+    struct sse_subscriber* next;
+    struct MHD_Connection* connection;
+    char topics[256]; // 逗号分隔的订阅主题，为空表示订阅全部
+    char* buf;        // 待发送数据 [off, len)
+    size_t off;
+    size_t len;
+    size_t cap;
+    int suspended;
+    int closed;
+};
+
+static struct sse_subscriber* sse_subscribers = NULL;
+static int sse_shutting_down = 0;
+static pthread_mutex_t sse_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int sse_topic_matches(const char* topics, const char* topic) {
+    if (topics[0] == '\0') {
+        return 1;
+    }
+    size_t topic_len = strlen(topic);
+    const char* p = topics;
+    while (p) {
+        const char* comma = strchr(p, ',');
+        size_t seg_len = comma ? (size_t)(comma - p) : strlen(p);
+        if (seg_len == topic_len && strncmp(p, topic, topic_len) == 0) {
+            return 1;
+        }
+        p = comma ? comma + 1 : NULL;
+    }
+    return 0;
+}
+
+// 追加待发送数据并唤醒挂起的连接，需持有 sse_mutex
+static void sse_enqueue(struct sse_subscriber* sub, const char* data, size_t len) {
+    size_t pending = sub->len - sub->off;
+    if (pending + len > SSE_QUEUE_LIMIT) {
+        // 慢速客户端：丢弃积压数据并结束流，客户端按 retry 自动重连
+        printf("SSE 客户端积压超过 %d 字节，断开连接\n", SSE_QUEUE_LIMIT);
+        sub->closed = 1;
+        sub->off = 0;
+        sub->len = 0;
+    } else {
+        if (sub->off > 0) {
+            memmove(sub->buf, sub->buf + sub->off, pending);
+            sub->off = 0;
+            sub->len = pending;
+        }
+        if (sub->len + len > sub->cap) {
+            size_t new_cap = sub->cap ? sub->cap * 2 : 1024;
+            while (new_cap < sub->len + len) {
+                new_cap *= 2;
+            }
+            char* new_buf = realloc(sub->buf, new_cap);
+            if (!new_buf) {
+                sub->closed = 1;
+                new_cap = sub->cap;
+            } else {
+                sub->buf = new_buf;
+            }
+            sub->cap = new_cap;
+        }
+        if (!sub->closed) {
+            memcpy(sub->buf + sub->len, data, len);
+            sub->len += len;
+        }
+    }
+    if (sub->suspended) {
+        sub->suspended = 0;
+        MHD_resume_connection(sub->connection);
+    }
+}
+
+int sse_publish(const char* topic, const char* data) {
+    // 多行数据拆分为多个 data 字段。SSE 客户端把 \r、\n、\r\n 都视为换行，
+    // 必须全部拆分，否则单独的 \r 会被客户端当作新字段，造成字段注入
+    size_t lines = 1;
+    for (const char* p = data; *p; p++) {
+        if (*p == '\n' || *p == '\r') {
+            lines++;
+        }
+    }
+    size_t cap = strlen(topic) + strlen(data) + lines * 7 + 16;
+    char* event = malloc(cap);
+    if (!event) {
+        return 0;
+    }
+    size_t len = (size_t)snprintf(event, cap, "event: %s\n", topic);
+    const char* line = data;
+    while (line) {
+        size_t line_len = strcspn(line, "\r\n");
+        const char* nl = line[line_len] ? line + line_len : NULL;
+        memcpy(event + len, "data: ", 6);
+        memcpy(event + len + 6, line, line_len);
+        len += 6 + line_len;
+        event[len++] = '\n';
+        if (nl && nl[0] == '\r' && nl[1] == '\n') {
+            nl++;
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    event[len++] = '\n';
+
+    int delivered = 0;
+    pthread_mutex_lock(&sse_mutex);
+    for (struct sse_subscriber* sub = sse_subscribers; sub; sub = sub->next) {
+        if (!sub->closed && sse_topic_matches(sub->topics, topic)) {
+            sse_enqueue(sub, event, len);
+            delivered++;
+        }
+    }
+    pthread_mutex_unlock(&sse_mutex);
+    free(event);
+    return delivered;
+}
+
+// 向所有订阅者发送注释行作为心跳，挂起期间 MHD 无法发现客户端断开，写入时才能发现
+static void sse_heartbeat(void) {
+    static const char ping[] = ": ping\n\n";
+    pthread_mutex_lock(&sse_mutex);
+    for (struct sse_subscriber* sub = sse_subscribers; sub; sub = sub->next) {
+        if (!sub->closed) {
+            sse_enqueue(sub, ping, sizeof(ping) - 1);
+        }
+    }
+    pthread_mutex_unlock(&sse_mutex);
+}
+
+// 结束所有订阅并恢复挂起的连接，MHD 不允许在存在挂起连接时停止服务器
+static void sse_close_all(void) {
+    pthread_mutex_lock(&sse_mutex);
+    sse_shutting_down = 1;
+    for (struct sse_subscriber* sub = sse_subscribers; sub; sub = sub->next) {
+        sub->closed = 1;
+        if (sub->suspended) {
+            sub->suspended = 0;
+            MHD_resume_connection(sub->connection);
+        }
+    }
+    pthread_mutex_unlock(&sse_mutex);
+}
+
+// SSE 响应内容回调，在事件循环线程中调用
+static ssize_t sse_reader(void* cls, uint64_t pos, char* buf, size_t max) {
+    struct sse_subscriber* sub = cls;
+    ssize_t ret;
+    pthread_mutex_lock(&sse_mutex);
+    if (sub->len > sub->off) {
+        size_t n = sub->len - sub->off;
+        if (n > max) {
+            n = max;
+        }
+        memcpy(buf, sub->buf + sub->off, n);
+        sub->off += n;
+        if (sub->off == sub->len) {
+            sub->off = 0;
+            sub->len = 0;
+        }
+        ret = (ssize_t)n;
+    } else if (sub->closed) {
+        ret = MHD_CONTENT_READER_END_OF_STREAM;
+    } else {
+        // 暂无数据，挂起连接直到 sse_enqueue 恢复
+        sub->suspended = 1;
+        MHD_suspend_connection(sub->connection);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&sse_mutex);
+    return ret;
+}
+
+static void sse_free(void* cls) {
+    struct sse_subscriber* sub = cls;
+    pthread_mutex_lock(&sse_mutex);
+    for (struct sse_subscriber** pp = &sse_subscribers; *pp; pp = &(*pp)->next) {
+        if (*pp == sub) {
+            *pp = sub->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sse_mutex);
+    printf("SSE 客户端已断开: %s\n", sub->topics[0] ? sub->topics : "*");
+    free(sub->buf);
+    free(sub);
+}
+
+// SSE 订阅请求处理：GET /events?topic=a,b
+static enum MHD_Result handle_sse_request(struct MHD_Connection* connection, const char* method) {
+    char msg[256];
+    if (strcmp(method, "GET") != 0) {
+        snprintf(msg, sizeof(msg), "{\"status\":\"error\",\"message\":\"SSE 不支持该请求方法: %s\"}", method);
+        return queue_json_message(connection, 405, msg);
+    }
+
+    struct sse_subscriber* sub = calloc(1, sizeof(struct sse_subscriber));
+    if (!sub) {
+        return MHD_NO;
+    }
+    const char* topics = MHD_lookup_connection_value(connection, MHD_GET_ARGUMENT_KIND, "topic");
+    snprintf(sub->topics, sizeof(sub->topics), "%s", topics ? topics : "");
+    sub->connection = connection;
+
+    struct MHD_Response* response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 1024,
+                                                                      &sse_reader, sub, &sse_free);
+    if (!response) {
+        free(sub);
+        return MHD_NO;
+    }
+    MHD_add_response_header(response, "Content-Type", "text/event-stream; charset=utf-8");
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+    MHD_add_response_header(response, "X-Accel-Buffering", "no");
+    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
+
+    static const char hello[] = "retry: 3000\n: connected\n\n";
+    pthread_mutex_lock(&sse_mutex);
+    int shutting_down = sse_shutting_down;
+    if (!shutting_down) {
+        sse_enqueue(sub, hello, sizeof(hello) - 1);
+        sub->next = sse_subscribers;
+        sse_subscribers = sub;
+    }
+    pthread_mutex_unlock(&sse_mutex);
+
+    enum MHD_Result ret;
+    if (shutting_down) {
+        MHD_destroy_response(response); // 由 sse_free 释放 sub
+        snprintf(msg, sizeof(msg), "{\"status\":\"error\",\"message\":\"服务器正在停止\"}");
+        return queue_json_message(connection, 503, msg);
+    }
+    printf("SSE 客户端已订阅: %s\n", sub->topics[0] ? sub->topics : "*");
+    ret = MHD_queue_response(connection, 200, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+// 脚本执行任务。HTTP 连接在执行期间被挂起，事件循环线程不会被脚本阻塞
+struct script_job {
+    struct script_job* next;
+    struct MHD_Connection* connection; // 定时任务为 NULL
+    int schedule_id;                   // 定时任务 id，HTTP 请求为 0
+    char filepath[512];
+    char* params;
+    // 执行结果，由执行线程填写
+    char* response_data;
+    int status_code;
+    const char* content_type;
+    struct script_response script_resp;
+};
+
+static struct script_job* job_queue_head = NULL;
+static struct script_job* job_queue_tail = NULL;
+static int jobs_pending = 0; // 已预留（排队和正在执行）的任务数
+static int executor_stopping = 0; // 停止后不再接受新任务
+static int jobs_queued = 0;     // 已提交但尚未被取走的任务数
+static int workers_min = 0;     // 常驻线程数，超出部分空闲超时后退出
+static int workers_total = 0;
+static int workers_idle = 0;
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_idle_cond = PTHREAD_COND_INITIALIZER;
+
+static void script_job_free(struct script_job* job) {
+    free(job->params);
+    free(job->response_data);
+    free(job);
+}
+
+// 执行脚本文件并生成响应内容
+static void run_script_job(struct script_job* job) {
+    job->status_code = 200;
+    job->content_type = CONTENT_TYPE_HTML;
+
+    if (!file_exists(job->filepath)) {
+        char notfound_msg[600];
+        snprintf(notfound_msg, sizeof(notfound_msg), "{\"status\":\"error\",\"message\":\"JS文件不存在: %s\"}", job->filepath);
+        job->response_data = strdup(notfound_msg);
+        job->status_code = 404;
+        job->content_type = CONTENT_TYPE_JSON;
+        return;
+    }
+
+    char* js_content = read_file_content(job->filepath);
+    if (!js_content) {
+        job->response_data = strdup("{\"status\":\"error\",\"message\":\"无法读取JS文件\"}");
+        job->status_code = 500;
+        job->content_type = CONTENT_TYPE_JSON;
+        return;
+    }
+
+    char* console_output = NULL;
+    char* result = execute_javascript(js_content, job->filepath, job->params, &job->script_resp, &console_output);
+    free(js_content);
+
+    // 返回值原样作为响应体，有console输出时追加在换行之后；返回undefined时只输出console
+    size_t result_len = result ? strlen(result) : 0;
+    size_t console_len = console_output ? strlen(console_output) : 0;
+    char* body = malloc(result_len + 1 + console_len + 1);
+    if (!body) {
+        free(result);
+        free(console_output);
+        job->response_data = strdup("{\"status\":\"error\",\"message\":\"内存分配失败\"}");
+        job->status_code = 500;
+        job->content_type = CONTENT_TYPE_JSON;
+        return;
+    }
+    size_t len = 0;
+    if (result) {
+        memcpy(body, result, result_len);
+        len = result_len;
+        if (console_len > 0) {
+            body[len++] = '\n';
+        }
+    }
+    if (console_len > 0) {
+        memcpy(body + len, console_output, console_len);
+        len += console_len;
+    }
+    body[len] = '\0';
+    job->response_data = body;
+    free(result);
+    free(console_output);
+
+    // 应用脚本设置的状态码和内容类型
+    if (job->script_resp.status_code != 0) {
+        job->status_code = job->script_resp.status_code;
+    }
+    if (job->script_resp.content_type[0] != '\0') {
+        job->content_type = job->script_resp.content_type;
+    }
+}
+
+static void schedule_job_done(struct script_job* job);
+
+// 脚本执行线程：取出任务执行，完成后恢复对应的连接发送结果
+static void* script_worker(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&job_mutex);
+        workers_idle++;
+        while (job_queue_head == NULL) {
+            if (workers_total <= workers_min) {
+                pthread_cond_wait(&job_cond, &job_mutex);
+                continue;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += WORKER_IDLE_TIMEOUT;
+            if (pthread_cond_timedwait(&job_cond, &job_mutex, &deadline) == ETIMEDOUT &&
+                job_queue_head == NULL && workers_total > workers_min) {
+                workers_idle--;
+                workers_total--;
+                pthread_mutex_unlock(&job_mutex);
+                release_thread_runtimes();
+                return NULL;
+            }
+        }
+        workers_idle--;
+        jobs_queued--;
+        struct script_job* job = job_queue_head;
+        job_queue_head = job->next;
+        if (job_queue_head == NULL) {
+            job_queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&job_mutex);
+
+        run_script_job(job);
+        if (job->connection) {
+            MHD_resume_connection(job->connection);
+        } else {
+            schedule_job_done(job);
+        }
+
+        pthread_mutex_lock(&job_mutex);
+        jobs_pending--;
+        if (jobs_pending == 0) {
+            pthread_cond_broadcast(&job_idle_cond);
+        }
+        pthread_mutex_unlock(&job_mutex);
+    }
+    return NULL;
+}
+
+// 调用方须持有 job_mutex
+static int spawn_worker_locked(void) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, script_worker, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(tid);
+    workers_total++;
+    return 0;
+}
+
+static int executor_start(int workers) {
+    int ret = 0;
+    pthread_mutex_lock(&job_mutex);
+    workers_min = workers;
+    for (int i = 0; i < workers && ret == 0; i++) {
+        ret = spawn_worker_locked();
+    }
+    pthread_mutex_unlock(&job_mutex);
+    return ret;
+}
+
+// 提交任务前预留名额，执行器停止后返回 -1。
+// HTTP 请求须在挂起连接之前预留，保证停止后不会再出现新的挂起连接
+static int executor_reserve(void) {
+    int ret = 0;
+    pthread_mutex_lock(&job_mutex);
+    if (executor_stopping) {
+        ret = -1;
+    } else {
+        jobs_pending++;
+    }
+    pthread_mutex_unlock(&job_mutex);
+    return ret;
+}
+
+// 提交已预留名额的任务
+static void executor_submit(struct script_job* job) {
+    pthread_mutex_lock(&job_mutex);
+    job->next = NULL;
+    if (job_queue_tail) {
+        job_queue_tail->next = job;
+    } else {
+        job_queue_head = job;
+    }
+    job_queue_tail = job;
+    jobs_queued++;
+    // 没有空闲线程时增加线程，慢脚本（或请求本服务的脚本）不会阻塞其它请求
+    // 创建失败时任务继续排队，由已有线程执行
+    if (jobs_queued > workers_idle && spawn_worker_locked() != 0) {
+        printf("无法创建脚本执行线程，任务将排队等待\n");
+    }
+    pthread_cond_signal(&job_cond);
+    pthread_mutex_unlock(&job_mutex);
+}
+
+// 停止接受新任务并等待已有任务完成，最多等待 timeout 秒，返回仍未完成的任务数
+static int executor_drain(int timeout) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout;
+    pthread_mutex_lock(&job_mutex);
+    executor_stopping = 1;
+    while (jobs_pending > 0) {
+        if (pthread_cond_timedwait(&job_idle_cond, &job_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    int pending = jobs_pending;
+    pthread_mutex_unlock(&job_mutex);
+    return pending;
+}
+
+// 定时任务，由主循环每秒检查，到期后直接提交到脚本执行线程，不经过 HTTP
+struct schedule_entry {
+    int id;             // 0 表示空闲
+    char script[256];
+    char params[512];
+    int interval;       // 执行间隔（秒）
+    time_t next_run;    // 单调时钟秒
+    int running;        // 上次执行尚未结束时跳过本轮，避免任务堆积
+};
+
+static struct schedule_entry schedule_entries[MAX_SCHEDULED_JOBS];
+static int schedule_next_id = 1;
+static pthread_mutex_t schedule_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+int schedule_script(const char* script, int interval, const char* params) {
+    if (interval <= 0 || strlen(script) >= sizeof(schedule_entries[0].script) ||
+        strlen(params) >= sizeof(schedule_entries[0].params)) {
+        return -1;
+    }
+    int id = -1;
+    pthread_mutex_lock(&schedule_mutex);
+    struct schedule_entry* slot = NULL;
+    for (int i = 0; i < MAX_SCHEDULED_JOBS; i++) {
+        struct schedule_entry* entry = &schedule_entries[i];
+        if (entry->id == 0) {
+            if (!slot) {
+                slot = entry;
+            }
+        } else if (strcmp(entry->script, script) == 0 && strcmp(entry->params, params) == 0) {
+            // 同一脚本和参数重复添加时只更新间隔，避免脚本每次执行都新增任务
+            entry->interval = interval;
+            id = entry->id;
+            break;
+        }
+    }
+    if (id < 0 && slot) {
+        slot->id = schedule_next_id++;
+        strcpy(slot->script, script);
+        strcpy(slot->params, params);
+        slot->interval = interval;
+        slot->next_run = monotonic_seconds() + interval;
+        slot->running = 0;
+        id = slot->id;
+        printf("[定时任务] 已添加 #%d: %s 每 %d 秒执行\n", id, script, interval);
+    }
+    pthread_mutex_unlock(&schedule_mutex);
+    return id;
+}
+
+int unschedule_script(int id) {
+    int removed = 0;
+    pthread_mutex_lock(&schedule_mutex);
+    for (int i = 0; i < MAX_SCHEDULED_JOBS; i++) {
+        if (id > 0 && schedule_entries[i].id == id) {
+            memset(&schedule_entries[i], 0, sizeof(schedule_entries[i]));
+            removed = 1;
+            printf("[定时任务] 已取消 #%d\n", id);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&schedule_mutex);
+    return removed;
+}
+
+// 提交所有到期的定时任务
+static void scheduler_tick(void) {
+    time_t now = monotonic_seconds();
+    pthread_mutex_lock(&schedule_mutex);
+    for (int i = 0; i < MAX_SCHEDULED_JOBS; i++) {
+        struct schedule_entry* entry = &schedule_entries[i];
+        if (entry->id == 0 || entry->running || now < entry->next_run) {
+            continue;
+        }
+        struct script_job* job = calloc(1, sizeof(struct script_job));
+        char* params = strdup(entry->params);
+        if (!job || !params || executor_reserve() != 0) {
+            free(job);
+            free(params);
+            continue;
+        }
+        snprintf(job->filepath, sizeof(job->filepath), "%s/worker/%s", worker_dir, entry->script);
+        job->params = params;
+        job->schedule_id = entry->id;
+        entry->running = 1;
+        entry->next_run = now + entry->interval;
+        executor_submit(job);
+    }
+    pthread_mutex_unlock(&schedule_mutex);
+}
+
+static void schedule_job_done(struct script_job* job) {
+    printf("[定时任务] #%d %s 执行完成，状态码 %d\n", job->schedule_id, job->filepath, job->status_code);
+    pthread_mutex_lock(&schedule_mutex);
+    for (int i = 0; i < MAX_SCHEDULED_JOBS; i++) {
+        if (schedule_entries[i].id == job->schedule_id) {
+            schedule_entries[i].running = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&schedule_mutex);
+    script_job_free(job);
+}
+
+// 加载 worker_dir/schedule.conf，每行格式: 间隔秒数 脚本名 [参数]，# 开头为注释
+static void load_schedule_config(void) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", worker_dir, SCHEDULE_CONFIG_NAME);
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    printf("加载定时任务配置: %s\n", path);
+    char line[1024];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '#' || *p == '\r' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        int interval = 0;
+        char script[256];
+        char params[512] = "";
+        int fields = sscanf(p, "%d %255s %511[^\r\n]", &interval, script, params);
+        if (fields < 2 || !is_valid_script_name(script) || schedule_script(script, interval, params) < 0) {
+            printf("定时任务配置第 %d 行无效: %s", line_no, line);
+        }
+    }
+    fclose(file);
+}
+
+// 请求结束回调：释放连接上的请求状态，客户端中途断开时同样会调用
+static void request_completed(void *cls, struct MHD_Connection *connection,
+                              void **con_cls, enum MHD_RequestTerminationCode toe) {
+    struct post_data* post = *con_cls;
+    if (post) {
+        if (post->job) {
+            script_job_free(post->job);
+        }
+        free(post->data);
+        free(post);
+        *con_cls = NULL;
+    }
+}
+
+// HTTP 请求处理函数
+static enum MHD_Result request_handler(void *cls, struct MHD_Connection *connection,
+                          const char *url, const char *method,
+                          const char *version, const char *upload_data,
+                          size_t *upload_data_size, void **con_cls) {
+    struct post_data* post = *con_cls;
+    
+    if (post == NULL) {
+        post = malloc(sizeof(struct post_data));
+        post->data = NULL;
+        post->size = 0;
+        post->allocated = 0;
+        post->job = NULL;
+        *con_cls = post;
+        printf("开始处理请求\n");
+        return MHD_YES;
+    }
+    
+    // 对于POST请求，需要等待数据接收完成
+    if (0 != *upload_data_size) {
+        printf("接收POST数据: %zu bytes\n", *upload_data_size);
+        
+        // 分配内存并复制数据
+        size_t new_size = post->size + *upload_data_size + 1;
+        
+        // 检查总大小限制
+        if (new_size > 1024 * 1024) { // 1MB限制
+            printf("POST数据过大: %zu bytes\n", new_size);
+            *upload_data_size = 0;
+            return MHD_YES;
+        }
+        
+        if (new_size > post->allocated) {
+            char* new_data = realloc(post->data, new_size);
+            if (new_data) {
+                post->data = new_data;
+                post->allocated = new_size;
+            } else {
+                printf("内存分配失败\n");
+                *upload_data_size = 0;
+                return MHD_YES;
+            }
+        }
+        
+        memcpy(post->data + post->size, upload_data, *upload_data_size);
+        post->size += *upload_data_size;
+        post->data[post->size] = '\0';
+        
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+    
+    // 脚本已在执行线程中完成，连接被恢复后发送结果
+    if (post->job) {
+        struct script_job* job = post->job;
+        char* job_output = job->response_data;
+        job->response_data = NULL;
+        if (!job_output) {
+            return MHD_NO;
+        }
+        return queue_body_response(connection, job->status_code, job->content_type,
+                                   job_output, strlen(job_output), &job->script_resp);
+    }
+    
+    printf("请求处理完成，开始响应\n");
+    if (post->data) {
+        printf("POST数据: %s\n", post->data);
+    }
+    // post 由 request_completed 释放，连接可继续用于 keep-alive 的后续请求
+    
+    char* response_data = NULL;
+    int status_code = 200;
+    
+    printf("收到请求: %s %s\n", method, url);
+    
+    // 静态文件挂载点，直接发送文件
+    if (strncmp(url, STATIC_URL_PREFIX, strlen(STATIC_URL_PREFIX)) == 0) {
+        return handle_static_request(connection, method, url + strlen(STATIC_URL_PREFIX));
+    }
+    
+    // SSE 推送通道
+    if (strcmp(url, SSE_URL_PATH) == 0) {
+        return handle_sse_request(connection, method);
+    }
+    
+    // 处理根路径，使用预压缩的缓存响应
+    if (strcmp(url, "/") == 0) {
+        pthread_once(&index_body_once, init_index_body);
+        return queue_cached_response(connection, 200, CONTENT_TYPE_HTML, &index_body);
+    }
+    // 处理所有其他请求，都当作JS文件执行
+    else {
+        const char* js_file = url + 1; // 跳过开头的 "/"
+        
+        // 获取查询参数
+        char params_buffer[1024] = "";
         MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, 
             (MHD_KeyValueIterator)&build_query_string, params_buffer);
         
@@ -497,95 +2184,51 @@ static enum MHD_Result request_handler(void *cls, struct MHD_Connection *connect
         
 
         
-        // 构建文件路径
-        char filepath[512];
-        snprintf(filepath, sizeof(filepath), "%s/worker/%.*s", worker_dir, (int)(sizeof(filepath) - strlen(worker_dir) - 8), js_filename);
-        
-        if (file_exists(filepath)) {
-            char* js_content = read_file_content(filepath);
-            if (js_content) {
-                char* result = execute_javascript(js_content, filepath, params);
-                free(js_content);
-                
-                if (result) {
-                    // 解析JSON并提取return和console
-                    char* return_start = strstr(result, "\"return\":\"");
-                    char* console_start = strstr(result, "\"console\":\"");
-                    
-                    if (return_start && console_start) {
-                        return_start += 10; // 跳过 "return":"
-                        console_start += 11; // 跳过 "console":"
-                        
-                        char* return_end = strchr(return_start, '"');
-                        char* console_end = strrchr(console_start, '"');
-                        
-                        if (return_end && console_end) {
-                            *return_end = '\0';
-                            *console_end = '\0';
-                            
-                            // 如果return是undefined，只输出console
-                            if (strcmp(return_start, "undefined") == 0) {
-                                response_data = strdup(console_start);
-                            } else {
-                                // 构建最终输出: return + 换行符 + console
-                                int total_len = strlen(return_start) + 1 + strlen(console_start) + 1;
-                                char* final_output = malloc(total_len);
-                                if (final_output) {
-                                    snprintf(final_output, total_len, "%s\n%s", return_start, console_start);
-                                    response_data = final_output;
-                                } else {
-                                    response_data = strdup(console_start);
-                                }
-                            }
-                        } else {
-                            response_data = result;
-                        }
-                    } else {
-                        response_data = result;
-                    }
-                } else {
-                    response_data = strdup("{\"status\":\"error\",\"message\":\"JS执行失败\"}");
-                    status_code = 500;
-                }
-            } else {
-                response_data = strdup("{\"status\":\"error\",\"message\":\"无法读取JS文件\"}");
-                status_code = 500;
-            }
-        } else {
-            char notfound_msg[600];
-            snprintf(notfound_msg, sizeof(notfound_msg), "{\"status\":\"error\",\"message\":\"JS文件不存在: %s\"}", filepath);
-            response_data = strdup(notfound_msg);
-            status_code = 404;
+        // 提交到脚本执行线程，挂起连接，事件循环继续处理其他连接
+        struct script_job* job = calloc(1, sizeof(struct script_job));
+        if (!job) {
+            response_data = strdup("{\"status\":\"error\",\"message\":\"内存分配失败\"}");
+            status_code = 500;
+            goto cleanup;
+        }
+        if (executor_reserve() != 0) {
+            free(job);
+            response_data = strdup("{\"status\":\"error\",\"message\":\"服务器正在停止\"}");
+            status_code = 503;
+            goto cleanup;
         }
+        snprintf(job->filepath, sizeof(job->filepath), "%s/worker/%.*s", worker_dir, (int)(sizeof(job->filepath) - strlen(worker_dir) - 8), js_filename);
+        job->connection = connection;
+        job->params = params;
+        post->job = job;
+        MHD_suspend_connection(connection);
+        executor_submit(job);
+        return MHD_YES;
         
 cleanup:
         if (params) {
             free(params);
         }
-        
-        // 清理POST数据
-        if (post) {
-            if (post->data) {
-                free(post->data);
-            }
-            free(post);
-        }
     }
     
-    response = MHD_create_response_from_buffer(strlen(response_data),
-                                              response_data,
-                                              MHD_RESPMEM_MUST_FREE);
-    
-    
-    
-                                              MHD_add_response_header(response, "Content-Type", "text/html; charset=utf-8");
-    
-    MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
-    
-    ret = MHD_queue_response(connection, status_code, response);
-    MHD_destroy_response(response);
-    
-    return (enum MHD_Result)ret;
+    if (!response_data) {
+        return MHD_NO;
+    }
+    return queue_body_response(connection, status_code, CONTENT_TYPE_JSON,
+                               response_data, strlen(response_data), NULL);
+}
+#else
+// libmicrohttpd 不可用时的占位函数
+int sse_publish(const char* topic, const char* data) {
+    return 0;
+}
+
+int schedule_script(const char* script, int interval, const char* params) {
+    return -1;
+}
+
+int unschedule_script(int id) {
+    return 0;
 }
 #endif
 
@@ -627,11 +2270,32 @@ int main(int argc, char **argv) {
     }
     printf("\n");
     int port = 8080;
+    int connection_timeout = DEFAULT_CONNECTION_TIMEOUT;
+    int io_threads = DEFAULT_IO_THREADS;
+    int script_workers = DEFAULT_SCRIPT_WORKERS;
     // 解析参数
     for (int i = 1; i < argc - 1; ++i) {
         if (strcmp(argv[i], "--port") == 0) {
             port = atoi(argv[i + 1]);
         }
+        if (strcmp(argv[i], "--timeout") == 0) {
+            connection_timeout = atoi(argv[i + 1]);
+            if (connection_timeout <= 0) {
+                connection_timeout = DEFAULT_CONNECTION_TIMEOUT;
+            }
+        }
+        if (strcmp(argv[i], "--io-threads") == 0) {
+            io_threads = atoi(argv[i + 1]);
+            if (io_threads <= 0) {
+                io_threads = DEFAULT_IO_THREADS;
+            }
+        }
+        if (strcmp(argv[i], "--workers") == 0) {
+            script_workers = atoi(argv[i + 1]);
+            if (script_workers <= 0) {
+                script_workers = DEFAULT_SCRIPT_WORKERS;
+            }
+        }
         if (strcmp(argv[i], "--wdir") == 0) {
             strncpy(worker_dir, argv[i + 1], sizeof(worker_dir) - 1);
             worker_dir[sizeof(worker_dir) - 1] = '\0';
@@ -648,6 +2312,8 @@ int main(int argc, char **argv) {
     printf("编译时间: %s %s\n", __DATE__, __TIME__);
     printf("目标架构: ARMv7\n");
     printf("Web服务端口: %d\n", port);
+    printf("连接空闲超时: %d 秒\n", connection_timeout);
+    printf("事件循环线程: %d, 常驻脚本执行线程: %d（忙碌时按需增加）\n", io_threads, script_workers);
     printf("工作目录: %s\n\n", worker_dir);
     
     char version[32] = "unknown";
@@ -677,9 +2343,19 @@ int main(int argc, char **argv) {
         printf("未检测到iptables，跳过端口放行检查\n");
     }
     
-    // 创建HTTP服务器
-    g_daemon = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION, port, NULL, NULL,
-                               &request_handler, NULL, MHD_OPTION_CONNECTION_TIMEOUT, 5, 
+    // 启动脚本执行线程
+    if (executor_start(script_workers) != 0) {
+        fprintf(stderr, "无法启动脚本执行线程\n");
+        return 1;
+    }
+    
+    // 创建HTTP服务器：少量事件循环线程处理所有连接（包括 SSE 长连接），
+    // 脚本在执行线程中运行，空闲超时放宽到 connection_timeout 以便轮询客户端复用 keep-alive 连接
+    g_daemon = MHD_start_daemon(MHD_USE_AUTO_INTERNAL_THREAD | MHD_ALLOW_SUSPEND_RESUME, port, NULL, NULL,
+                               &request_handler, NULL,
+                               MHD_OPTION_THREAD_POOL_SIZE, (unsigned int)io_threads,
+                               MHD_OPTION_CONNECTION_TIMEOUT, (unsigned int)connection_timeout,
+                               MHD_OPTION_NOTIFY_COMPLETED, &request_completed, NULL,
                                MHD_OPTION_END);
     
     if (g_daemon == NULL) {
@@ -690,6 +2366,8 @@ int main(int argc, char **argv) {
     printf("HTTP服务器已启动，监听端口 %d\n", port);
     printf("访问 http://localhost:%d 查看服务\n", port);
     printf("访问 http://localhost:%d/文件名.js 执行JS文件\n", port);
+    printf("访问 http://localhost:%d%s文件名 获取 %s/%s 下的静态文件\n", port, STATIC_URL_PREFIX, worker_dir, STATIC_DIR_NAME);
+    printf("访问 http://localhost:%d%s?topic=主题 订阅脚本 publish() 推送的消息\n", port, SSE_URL_PATH);
     printf("按 Ctrl+C 停止服务器\n");
     
     // 检查worker目录
@@ -720,9 +2398,33 @@ int main(int argc, char **argv) {
     }
     
     
-    // 等待信号
-    while (g_daemon != NULL) {
+    load_schedule_config();
+    
+    // 等待信号，同时执行到期的定时任务并定时发送 SSE 心跳
+    int ticks = 0;
+    while (!g_stop) {
         sleep(1);
+        scheduler_tick();
+        if (++ticks % SSE_HEARTBEAT_INTERVAL == 0) {
+            sse_heartbeat();
+        }
+    }
+    
+    // MHD 不允许在存在挂起连接时停止：先停止接受新连接，结束 SSE 订阅，
+    // 再拒绝新的脚本请求并等待正在执行的脚本完成
+    printf("正在停止HTTP服务器...\n");
+    int listen_fd = MHD_quiesce_daemon(g_daemon);
+    sse_close_all();
+    int pending = executor_drain(SHUTDOWN_DRAIN_TIMEOUT);
+    if (pending > 0) {
+        // 仍有脚本未结束，其连接处于挂起状态，无法安全停止 MHD，直接退出
+        printf("仍有 %d 个脚本未执行完成，强制退出\n", pending);
+        exit(1);
+    }
+    MHD_stop_daemon(g_daemon);
+    g_daemon = NULL;
+    if (listen_fd >= 0) {
+        close(listen_fd);
     }
 #else
     printf("libmicrohttpd 功能不可用，无法启动Web服务器\n");
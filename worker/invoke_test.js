@@ -0,0 +1,13 @@
+// invoke_test.js - 演示在进程内调用其他脚本和添加定时任务
+
+// 直接执行 dev.js，不经过 HTTP，返回 {success, return, console, status}
+const res = invoke("dev.js", { name: "invoke", action: "info" });
+console.log("success:", res.success);
+console.log("status:", res.status);
+console.log("return:", res.return);
+
+// 定时任务示例：每 60 秒执行一次 publish_test.js，任务在进程退出前一直有效，
+// 重复添加只会更新间隔，不再需要时调用 unschedule(id) 取消
+// 也可以在 worker_dir/schedule.conf 中配置，每行: 间隔秒数 脚本名 [参数]
+// const id = schedule("publish_test.js", 60, "source=schedule");
+// unschedule(id);
@@ -0,0 +1,10 @@
+// publish_test.js - 演示向 SSE 订阅者推送消息
+// 订阅: curl -N http://localhost:8080/events?topic=status
+
+const delivered = publish("status", {
+    message: "状态更新",
+    params: request_params,
+    timestamp: new Date().toISOString()
+});
+
+console.log("已推送给", delivered, "个订阅者");
@@ -0,0 +1,13 @@
+// response_test.js - 演示脚本设置状态码、响应头和内容类型
+
+set_status(200);
+set_content_type("application/json; charset=utf-8");
+set_header("Cache-Control", "no-cache");
+
+const result = {
+    message: "响应头设置完成",
+    params: request_params,
+    timestamp: new Date().toISOString()
+};
+
+JSON.stringify(result);